@@ -0,0 +1,172 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#define CLIENT_SPECULATE 0  // The replay must match the warm-up, without a second thread
+#include "client.h"
+#include "self_play.h"
+#include "server.h"
+
+/*
+ * Benchmarks of the client, on self-play as in generate.cpp (see self_play.h).
+ *
+ * Usage: benchmark alloc|time <rows> <columns> <mines> <games> <seed>
+ *
+ * time measures the server, in ns per block to lay out a board and visit all of its safe blocks, and the client, in
+ * seconds and µs per move of self-play. benchmark_dynamic is built with DYNAMIC_SHAPE_ONLY, which makes both server.h
+ * and client.h use the runtime board size on every size, to compare with the fixed shapes.
+ *
+ * alloc counts the heap allocations of every move of the client, i.e. every call of Decide(), including PassMap() but
+ * not the server. The same games are played twice. The first pass warms up the arena, the pools and the capacity of
+ * every container. ResetClient() makes each game independent of the ones before, so the second pass replays the first
+ * exactly, and every move of it must allocate nothing. Otherwise, or if the replay differs, the benchmark fails with 1.
+ *
+ * Allocations are counted in operator new, and in malloc through the linker option --wrap=malloc, which also catches
+ * the blocks of the arena.
+ */
+
+std::atomic<uint64_t> allocations{0};
+std::atomic<bool> counting{false};
+
+extern "C" void *__real_malloc(size_t size);
+
+extern "C" void *__wrap_malloc(size_t size) {
+  if (counting.load(std::memory_order_relaxed)) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+  }
+  return __real_malloc(size);
+}
+
+void *operator new(size_t size) {
+  if (void *block = std::malloc(size == 0 ? 1 : size)) {
+    return block;
+  }
+  throw std::bad_alloc();
+}
+void *operator new[](size_t size) { return operator new(size); }
+// Not inlined, or GCC sees free() on the result of new, and warns
+__attribute__((noinline)) void operator delete(void *block) noexcept { std::free(block); }
+void operator delete[](void *block) noexcept { operator delete(block); }
+void operator delete(void *block, size_t) noexcept { operator delete(block); }
+void operator delete[](void *block, size_t) noexcept { operator delete(block); }
+
+/* Visits the block and passes the map to the client, counting only the latter. */
+void Execute(int row, int column) {
+  counting = false;
+  VisitBlock(row, column);
+  counting = true;
+  PassMap();
+}
+
+/* Counts the allocations of one move, even when the game ends in it. */
+class MoveCounter {
+ private:
+  uint64_t start_;
+  uint64_t &moves_;
+  uint64_t &allocating_moves_;
+  uint64_t &total_;
+
+ public:
+  MoveCounter(uint64_t &moves, uint64_t &allocating_moves, uint64_t &total)
+      : start_(allocations), moves_(moves), allocating_moves_(allocating_moves), total_(total) {
+    counting = true;
+  }
+  ~MoveCounter() {
+    counting = false;
+    uint64_t count = allocations - start_;
+    ++moves_;
+    allocating_moves_ += count != 0;
+    total_ += count;
+  }
+};
+
+struct AllocResult {
+  int wins = 0;
+  uint64_t moves = 0;
+  uint64_t allocating_moves = 0;
+  uint64_t allocations = 0;
+};
+
+AllocResult PlayPass(int mines, int games, uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  AllocResult result;
+  for (int game = 0; game < games; ++game) {
+    result.wins += PlayGame(rng, mines, [&result] {
+      MoveCounter counter(result.moves, result.allocating_moves, result.allocations);
+      Decide();
+    });
+  }
+  counting = false;
+  return result;
+}
+
+int RunAlloc(int mines, int games, uint64_t seed) {
+  AllocResult warmup = PlayPass(mines, games, seed);
+  AllocResult replay = PlayPass(mines, games, seed);
+  for (const auto &[name, result] : {std::pair{"warm-up", warmup}, std::pair{"replay", replay}}) {
+    std::cout << name << ": " << games << " games, " << result.wins << " wins, " << result.moves << " moves, "
+              << result.allocating_moves << " of them allocating, " << result.allocations << " allocations"
+              << std::endl;
+  }
+  if (replay.wins != warmup.wins || replay.moves != warmup.moves) {
+    std::cout << "The replay differs from the warm-up." << std::endl;
+    return 1;
+  }
+  return replay.allocating_moves != 0;
+}
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int RunTime(int mines, int games, uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  auto start = std::chrono::steady_clock::now();
+  for (int game = 0; game < games; ++game) {
+    NewBoard(rng, mines);
+    for (int i = 0; i < rows; ++i) {
+      for (int j = 0; j < columns; ++j) {
+        if (mine_count[i][j] != -1) {
+          VisitBlock(i, j);
+        }
+      }
+    }
+  }
+  double server = SecondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  AllocResult result = PlayPass(mines, games, seed);
+  double client = SecondsSince(start);
+
+  std::cout << "server: " << games << " boards, " << server * 1e9 / games / (rows * columns) << " ns per block"
+            << std::endl;
+  std::cout << "client: " << games << " games, " << result.wins << " wins, " << client << " s, "
+            << client * 1e6 / result.moves << " us per move" << std::endl;
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  std::string mode = argc > 1 ? argv[1] : "";
+  if (argc != 7 || (mode != "alloc" && mode != "time")) {
+    std::cerr << "Usage: " << argv[0] << " alloc|time <rows> <columns> <mines> <games> <seed>" << std::endl;
+    return 1;
+  }
+  rows = std::atoi(argv[2]);
+  columns = std::atoi(argv[3]);
+  int mines = std::atoi(argv[4]);
+  int games = std::atoi(argv[5]);
+  uint64_t seed = std::strtoull(argv[6], nullptr, 10);
+  if (rows < 1 || columns < 1 || rows + 2 > static_cast<int>(kMAPSIZE) || columns + 2 > static_cast<int>(kMAPSIZE) ||
+      mines < 0 || mines >= rows * columns || games < 0) {
+    std::cerr << "Invalid arguments." << std::endl;
+    return 1;
+  }
+  InitSelfPlay();
+  return mode == "alloc" ? RunAlloc(mines, games, seed) : RunTime(mines, games, seed);
+}
@@ -0,0 +1,209 @@
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#define CLIENT_SPECULATE 0  // The samples should not depend on a second core
+#include "client.h"
+#include "self_play.h"
+#include "server.h"
+
+/*
+ * Self-play training data generator.
+ *
+ * Usage: generate <rows> <columns> <mines> <games> <seed> <shards> <prefix>
+ *
+ * Each shard is a separate process (the game state is global, so threads cannot share it). Shard k plays games/shards
+ * games on random boards, seeded by ShardSeed(seed, k), and writes <prefix>.<k>.bin. The same arguments always give the
+ * same files. If a shard cannot be started or fails to write its file, the process exits with 1. The client runs its
+ * lookahead on one thread per shard, so <shards> processes keep about as many cores busy.
+ *
+ * At every decision point, i.e. every call of Execute(), one sample is written for each unknown block next to a visited
+ * one. A sample is the kWindow * kWindow window of the client map around the block, plus whether it is a mine.
+ *
+ * The file is a list of blocks. Each block is
+ *     uint32_t magic, uint32_t count, uint32_t window
+ *     uint8_t  windows[count][window * window]
+ *     uint8_t  labels[count]
+ * and a window byte is 0 ~ 8 for a visited block, then kUnknown, kMine, kSafe, or kOutside.
+ */
+
+constexpr int kWindow = 11;
+constexpr int kRadius = kWindow / 2;
+constexpr size_t kBlockSamples = 1 << 18;
+constexpr uint32_t kMagic = 0x4D535744;  // "DWSM"
+
+constexpr uint8_t kUnknown = 9;
+constexpr uint8_t kMine = 10;
+constexpr uint8_t kSafe = 11;
+constexpr uint8_t kOutside = 12;
+
+/**
+ * @brief Buffered columnar writer of samples.
+ */
+class SampleWriter {
+ private:
+  std::string path_;
+  FILE *file_;
+  std::vector<uint8_t> windows_;
+  std::vector<uint8_t> labels_;
+
+  /* A shard with a truncated file is useless, so give up on the first error. */
+  void Fail() {
+    std::perror(path_.c_str());
+    std::exit(1);
+  }
+
+ public:
+  explicit SampleWriter(const std::string &path) : path_(path), file_(std::fopen(path.c_str(), "wb")) {
+    if (file_ == nullptr) {
+      Fail();
+    }
+    windows_.reserve(kBlockSamples * kWindow * kWindow);
+    labels_.reserve(kBlockSamples);
+  }
+  ~SampleWriter() {
+    Flush();
+    if (std::fclose(file_) != 0) {
+      Fail();
+    }
+  }
+
+  /* Append the window around client block (x, y), 1-based. */
+  void Append(int x, int y, bool is_mine) {
+    for (int i = x - kRadius; i <= x + kRadius; ++i) {
+      for (int j = y - kRadius; j <= y + kRadius; ++j) {
+        windows_.push_back(Encode(i, j));
+      }
+    }
+    labels_.push_back(is_mine);
+    if (labels_.size() == kBlockSamples) {
+      Flush();
+    }
+  }
+
+  void Flush() {
+    if (labels_.empty()) {
+      return;
+    }
+    uint32_t header[3] = {kMagic, static_cast<uint32_t>(labels_.size()), kWindow};
+    if (std::fwrite(header, sizeof(header), 1, file_) != 1 ||
+        std::fwrite(windows_.data(), 1, windows_.size(), file_) != windows_.size() ||
+        std::fwrite(labels_.data(), 1, labels_.size(), file_) != labels_.size()) {
+      Fail();
+    }
+    windows_.clear();
+    labels_.clear();
+  }
+
+ private:
+  static uint8_t Encode(int x, int y) {
+    if (!is_in_range(x, y)) {
+      return kOutside;
+    }
+    const state &block = map[x][y];
+    if (block.is_visited()) {
+      return block.get_mine_count();
+    } else if (block.is_definitely_mine()) {
+      return kMine;
+    } else if (block.is_definitely_safe()) {
+      return kSafe;
+    }
+    return kUnknown;
+  }
+};
+
+SampleWriter *writer = nullptr;
+uint64_t sample_count = 0;
+
+/* Write one sample for every unknown block next to a visited one. */
+void RecordDecision() {
+  auto has_visited = [](int x, int y) { return is_in_range(x, y) && map[x][y].is_visited(); };
+  for (int i = 1; i <= rows; ++i) {
+    for (int j = 1; j <= columns; ++j) {
+      if (map[i][j].is_visited() || !count_if(i, j, has_visited)) {
+        continue;
+      }
+      writer->Append(i, j, mine_count[i - 1][j - 1] == -1);
+      ++sample_count;
+    }
+  }
+}
+
+/**
+ * @brief The implementation of function Execute for self-play
+ * @details Records the decision, then visits the block and passes the map to the client.
+ */
+void Execute(int row, int column) {
+  if (writer != nullptr) {
+    RecordDecision();
+  }
+  VisitBlock(row, column);
+  PassMap();
+}
+
+/**
+ * @brief The seed of shard k, as the k-th output of splitmix64 seeded by seed
+ * @details Unlike seed + k, nearby seeds do not share shards, e.g. shard 1 of seed 7 and shard 0 of seed 8 differ.
+ */
+uint64_t ShardSeed(uint64_t seed, int shard) {
+  return MixHash(seed + 0x9E3779B97F4A7C15ULL * (static_cast<uint64_t>(shard) + 1));
+}
+
+void RunShard(int mines, int games, uint64_t seed, const std::string &path) {
+  std::mt19937_64 rng(seed);
+  int wins = 0;
+  {
+    SampleWriter shard_writer(path);  // Closed before the summary, which is only printed on success
+    writer = &shard_writer;
+    for (int game = 0; game < games; ++game) {
+      wins += PlayGame(rng, mines, Decide);
+    }
+    writer = nullptr;
+  }
+  std::cout << path << ": " << games << " games, " << wins << " wins, " << sample_count << " samples" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 8) {
+    std::cerr << "Usage: " << argv[0] << " <rows> <columns> <mines> <games> <seed> <shards> <prefix>" << std::endl;
+    return 1;
+  }
+  rows = std::atoi(argv[1]);
+  columns = std::atoi(argv[2]);
+  int mines = std::atoi(argv[3]);
+  int games = std::atoi(argv[4]);
+  uint64_t seed = std::strtoull(argv[5], nullptr, 10);
+  int shards = std::atoi(argv[6]);
+  std::string prefix = argv[7];
+  if (rows < 1 || columns < 1 || rows + 2 > static_cast<int>(kMAPSIZE) || columns + 2 > static_cast<int>(kMAPSIZE) ||
+      mines < 0 || mines >= rows * columns || games < 0 || shards < 1) {
+    std::cerr << "Invalid arguments." << std::endl;
+    return 1;
+  }
+  InitSelfPlay();  // The shards already take one core each
+
+  int failed = 0;
+  for (int shard = 0; shard < shards; ++shard) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      std::perror("fork");  // This shard is never written
+      ++failed;
+    } else if (pid == 0) {
+      int count = games / shards + (shard < games % shards);
+      RunShard(mines, count, ShardSeed(seed, shard), prefix + "." + std::to_string(shard) + ".bin");
+      return 0;
+    }
+  }
+  int status;
+  while (wait(&status) > 0) {
+    failed += !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+  }
+  return failed != 0;
+}
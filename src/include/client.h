@@ -1,13 +1,27 @@
 #ifndef CLIENT_H
 #define CLIENT_H
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <new>
 #include <utility>
 #include <bitset>
 #include <vector>
 #include <algorithm>
 #include <unordered_set>
 #include <unordered_map>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <thread>
 
 
 using _Pos_Type = std::pair <int,int>;
@@ -42,6 +56,264 @@ using _Node_Set = std::unordered_set <_Node_Type,_Node_Hash,_Node_EQ>;
 using _Node_Map = std::unordered_map <_Node_Type,_Node_Set,_Node_Hash,_Node_EQ>;
 
 
+/**
+ * @brief Bump allocator for scratch data of one move.
+ * Nothing is freed until reset(). If one move has taken more than one block,
+ * reset() merges them into one, so that later moves never call malloc.
+ */
+class _Arena {
+  private:
+    struct _Block {
+        _Block *next;
+        size_t  size;
+    };
+    inline static constexpr size_t kHEADER = sizeof(std::max_align_t) * 2;
+    inline static constexpr size_t kBLOCK  = size_t(1) << 16;
+
+    _Block *head = nullptr; /* Current block, newest first. */
+    size_t  used = 0;       /* Bytes used in current block. */
+
+    static _Block *new_block(size_t __size, _Block *__next) {
+        auto *__block = static_cast <_Block *> (std::malloc(kHEADER + __size));
+        if (!__block) throw std::bad_alloc();
+        __block->next = __next;
+        __block->size = __size;
+        return __block;
+    }
+
+  public:
+    _Arena() = default;
+    _Arena(const _Arena &) = delete;
+    _Arena &operator = (const _Arena &) = delete;
+    ~_Arena() {
+        while (head) {
+            auto *__next = head->next;
+            std::free(head);
+            head = __next;
+        }
+    }
+
+    void *allocate(size_t __n, size_t __align) {
+        size_t __pos = head ? (used + __align - 1) & ~(__align - 1) : 0;
+        if (!head || __pos + __n > head->size) {
+            size_t __size = head ? head->size * 2 : kBLOCK;
+            while (__size < __n) __size *= 2;
+            head = new_block(__size,head);
+            __pos = 0;
+        }
+        used = __pos + __n;
+        return reinterpret_cast <std::byte *> (head) + kHEADER + __pos;
+    }
+
+    /* Release all the scratch data at once. */
+    void reset() {
+        used = 0;
+        if (!head || !head->next) return;
+        size_t __size = 0;
+        while (head) {
+            auto *__next = head->next;
+            __size += head->size;
+            std::free(head);
+            head = __next;
+        }
+        head = new_block(__size,nullptr);
+    }
+};
+
+inline static _Arena arena = {};
+
+/* Reset the arena when leaving the scope. */
+struct _Arena_Guard {
+    ~_Arena_Guard() { arena.reset(); }
+};
+
+/* Allocator for std containers, using the arena. Deallocation is a no-op. */
+template <class _Tp>
+struct _Arena_Allocator {
+    using value_type = _Tp;
+
+    _Arena_Allocator() noexcept = default;
+    template <class _Up>
+    _Arena_Allocator(const _Arena_Allocator <_Up> &) noexcept {}
+
+    _Tp *allocate(size_t __n) {
+        return static_cast <_Tp *> (arena.allocate(__n * sizeof(_Tp),alignof(_Tp)));
+    }
+    void deallocate(_Tp *, size_t) noexcept {}
+
+    template <class _Up>
+    bool operator == (const _Arena_Allocator <_Up> &) const noexcept { return true; }
+    template <class _Up>
+    bool operator != (const _Arena_Allocator <_Up> &) const noexcept { return false; }
+};
+
+template <class _Tp>
+using _Arena_Vector = std::vector <_Tp,_Arena_Allocator <_Tp>>;
+
+using _Tmp_Pos_List = _Arena_Vector <_Pos_Type>;
+
+
+/**
+ * @brief Free lists of memory blocks, for data kept across moves.
+ * Sizes are rounded up to a power of two, and each class has a free list,
+ * one set per thread. A freed block goes to the list of its class on the
+ * freeing thread, and the next allocation of that class takes it back, so
+ * containers which grow and shrink with the game stop touching the heap
+ * once warmed up. The blocks go back to the heap when the thread exits.
+ */
+class _Block_Pool {
+  private:
+    /* A free block holds the link to the next one, so freeing never allocates. */
+    struct _Free_Block {
+        _Free_Block *next;
+    };
+    inline static constexpr size_t kMIN_CLASS = 3;  /* 8 bytes, enough for the link. */
+    inline static constexpr size_t kCLASSES   = 64;
+
+    struct _Free_Lists {
+        _Free_Block *head[kCLASSES] = {};
+
+        ~_Free_Lists() {
+            destroyed = true;
+            for(auto *&__list : head) {
+                while (__list) {
+                    auto *__next = __list->next;
+                    ::operator delete(__list);
+                    __list = __next;
+                }
+            }
+        }
+    };
+
+    /* Blocks freed after the lists of the thread are gone skip the pool. */
+    inline static thread_local bool destroyed = false;
+
+    static _Free_Lists &lists() {
+        static thread_local _Free_Lists __lists;
+        return __lists;
+    }
+
+    /* Log2 of the smallest class holding __size bytes. */
+    static size_t size_class(size_t __size) noexcept {
+        if (__size <= (size_t(1) << kMIN_CLASS)) return kMIN_CLASS;
+        return 64 - __builtin_clzll(static_cast <unsigned long long> (__size - 1));
+    }
+
+  public:
+    static void *allocate(size_t __size) {
+        size_t __class = size_class(__size);
+        if (!destroyed) {
+            auto *&__head = lists().head[__class];
+            if (__head) {
+                auto *__block = __head;
+                __head = __block->next;
+                return __block;
+            }
+        }
+        return ::operator new(size_t(1) << __class);
+    }
+
+    static void deallocate(void *__ptr,size_t __size) noexcept {
+        if (destroyed) return ::operator delete(__ptr);
+        auto *&__head = lists().head[size_class(__size)];
+        __head = new (__ptr) _Free_Block {__head};
+    }
+};
+
+/* Allocator for std containers kept across moves, using _Block_Pool. */
+template <class _Tp>
+struct _Pool_Allocator {
+    using value_type = _Tp;
+
+    _Pool_Allocator() noexcept = default;
+    template <class _Up>
+    _Pool_Allocator(const _Pool_Allocator <_Up> &) noexcept {}
+
+    _Tp *allocate(size_t __n) {
+        return static_cast <_Tp *> (_Block_Pool::allocate(__n * sizeof(_Tp)));
+    }
+    void deallocate(_Tp *__ptr, size_t __n) noexcept {
+        _Block_Pool::deallocate(__ptr,__n * sizeof(_Tp));
+    }
+
+    template <class _Up>
+    bool operator == (const _Pool_Allocator <_Up> &) const noexcept { return true; }
+    template <class _Up>
+    bool operator != (const _Pool_Allocator <_Up> &) const noexcept { return false; }
+};
+
+/* Vector kept across moves, whose storage is recycled through _Block_Pool. */
+template <class _Tp>
+using _Pool_Vector = std::vector <_Tp,_Pool_Allocator <_Tp>>;
+
+
+/**
+ * @brief Open-addressing hash set of packed keys, stored in the arena.
+ * Linear probing on a power-of-two table, kept at most half full.
+ */
+class _Flat_Set {
+  private:
+    inline static constexpr uint32_t kEMPTY = UINT32_MAX;
+
+    _Arena_Vector <uint32_t> table = {};
+    size_t                   count = 0;
+
+    static size_t hash(uint32_t __key) noexcept {
+        return static_cast <size_t> (__key * 0x9E3779B1u);
+    }
+    void rehash(size_t __size) {
+        _Arena_Vector <uint32_t> __old(__size,kEMPTY);
+        __old.swap(table);
+        for(auto __key : __old)
+            if (__key != kEMPTY) insert_unique(__key);
+    }
+    void insert_unique(uint32_t __key) noexcept {
+        size_t __mask = table.size() - 1;
+        size_t __pos  = hash(__key) & __mask;
+        while (table[__pos] != kEMPTY) __pos = (__pos + 1) & __mask;
+        table[__pos] = __key;
+    }
+
+  public:
+    _Flat_Set() : _Flat_Set(16) {}
+    explicit _Flat_Set(size_t __hint) {
+        size_t __size = 16;
+        while (__size < __hint * 2) __size *= 2;
+        table.assign(__size,kEMPTY);
+    }
+
+    /* Return true iff the key is newly inserted. */
+    bool insert(uint32_t __key) {
+        size_t __mask = table.size() - 1;
+        size_t __pos  = hash(__key) & __mask;
+        while (table[__pos] != kEMPTY) {
+            if (table[__pos] == __key) return false;
+            __pos = (__pos + 1) & __mask;
+        }
+        table[__pos] = __key;
+        if (++count * 2 > table.size()) rehash(table.size() * 2);
+        return true;
+    }
+    bool contains(uint32_t __key) const noexcept {
+        size_t __mask = table.size() - 1;
+        size_t __pos  = hash(__key) & __mask;
+        while (table[__pos] != kEMPTY) {
+            if (table[__pos] == __key) return true;
+            __pos = (__pos + 1) & __mask;
+        }
+        return false;
+    }
+    size_t size() const noexcept { return count; }
+};
+
+inline uint32_t pack_pos(int x,int y) noexcept {
+    return static_cast <uint32_t> (x) << 16 | static_cast <uint32_t> (y);
+}
+inline uint32_t pack_node(const _Node_Type &__node) noexcept {
+    return pack_pos(__node.x,__node.y) << 1 | __node.flag;
+}
+
+
 struct state {
   public:
     inline static const uint8_t NPOS        = 255;
@@ -118,16 +390,59 @@ struct state {
     bool is_guessed_safe() const noexcept {
         return flag & GUESS_SAFE;
     }
+
+    bool operator == (const state &__rhs) const noexcept {
+        return mine == __rhs.mine && flag == __rhs.flag;
+    }
+    bool operator != (const state &__rhs) const noexcept {
+        return !(*this == __rhs);
+    }
 };
 
 
 extern int rows;     // The count of rows of the game map
 extern int columns;  // The count of columns of the game map
 
-inline static _Pos_List work_list = {};
+/* Thread local, so that lookahead workers can run take_safe on their own. */
+inline thread_local _Pos_List work_list = {};
 inline static constexpr _Pos_Type   kNOTFOUND   = {0,0};
 inline static constexpr size_t      kMAPSIZE    = 64;
-inline state map[kMAPSIZE][kMAPSIZE] = {};
+inline thread_local state map[kMAPSIZE][kMAPSIZE] = {};
+
+
+/**
+ * @brief Board size known at compile time.
+ * Most games are played on 9 * 9, 16 * 16 or 16 * 30 boards. With the size
+ * fixed, the compiler can fold the bounds checks and unroll the loops.
+ */
+template <int kROWS,int kCOLUMNS>
+struct _Fixed_Shape {
+    static constexpr int Rows()    { return kROWS; }
+    static constexpr int Columns() { return kCOLUMNS; }
+};
+
+/* Board size read from rows and columns at runtime. */
+struct _Dynamic_Shape {
+    static int Rows()    { return rows; }
+    static int Columns() { return columns; }
+};
+
+/**
+ * @brief Call __func with the shape of the current board.
+ * It is a _Fixed_Shape for the classic sizes, or _Dynamic_Shape for any other.
+ * With DYNAMIC_SHAPE_ONLY defined, it is always _Dynamic_Shape.
+ */
+template <class _Func>
+decltype(auto) dispatch_shape(_Func &&__func) {
+#ifdef DYNAMIC_SHAPE_ONLY
+    return __func(_Dynamic_Shape {});
+#else
+    if (rows == 9  && columns == 9)  return __func(_Fixed_Shape <9,9>   {});
+    if (rows == 16 && columns == 16) return __func(_Fixed_Shape <16,16> {});
+    if (rows == 16 && columns == 30) return __func(_Fixed_Shape <16,30> {});
+    return __func(_Dynamic_Shape {});
+#endif
+}
 
 
 void _Debug() {
@@ -161,19 +476,23 @@ void InitGame() {
     Execute(first_row, first_column);
 }
 
+/* Update the block (i,j) from one char of the printed map. */
+void read_block(int i,int j,char __cur) {
+    if (std::isdigit(__cur)) {
+        map[i][j].set_visited(__cur - '0');
+        work_list.emplace_back(i,j);
+    } else {
+        map[i][j].set_unknown();
+    }
+}
+
 void ReadMap() {
+    static std::string __buf; /* Reused, so no allocation per move. */
     work_list.clear();
     for (int i = 1 ; i <= rows ; ++i) {
-        std::string __buf;
         std::cin >> __buf;
         for (int j = 1 ; j <= columns ; ++j) {
-            auto __cur = __buf[j - 1]; /* Current char. */
-            if (std::isdigit(__cur)) {
-                map[i][j].set_visited(__cur - '0');
-                work_list.emplace_back(i,j);
-            } else {
-                map[i][j].set_unknown();
-            }
+            read_block(i,j,__buf[j - 1]);
         }
     }
 }
@@ -202,35 +521,45 @@ void update(int x,int y,_Func &&__work) {
  * @brief Reset the guessing state.
  * Use it before any guessing.
 */
-void init_guessing() {
-    for(int i = 1 ; i <= rows ; ++i) {
-        for(int j = 1 ; j <= columns ; ++j) {
+template <class _Shape>
+void init_guessing(_Shape) {
+    for(int i = 1 ; i <= _Shape::Rows() ; ++i) {
+        for(int j = 1 ; j <= _Shape::Columns() ; ++j) {
             map[i][j].reset_guess();
         }
     }
 }
+void init_guessing() {
+    dispatch_shape([](auto __shape) { init_guessing(__shape); });
+}
 
 /**
  * @brief Collect all unknown adjacent to visited.
  * @return The list of required data (no duplicate).
  */
-_Pos_List collect_adjacent_unknown() {
-    _Pos_Set __set = {};
+template <class _Shape>
+_Tmp_Pos_List collect_adjacent_unknown(_Shape) {
+    _Flat_Set     __set  = {};
+    _Tmp_Pos_List __list = {};
     auto &&__collect_unknown = [&](int x,int y) -> void {
-        if (map[x][y].is_unknown()) __set.emplace(x,y);
+        if (map[x][y].is_unknown() && __set.insert(pack_pos(x,y))) __list.emplace_back(x,y);
     };
-    for(int i = 1 ; i <= rows ; ++i) {
-        for(int j = 1 ; j <= columns ; ++j) {
+    for(int i = 1 ; i <= _Shape::Rows() ; ++i) {
+        for(int j = 1 ; j <= _Shape::Columns() ; ++j) {
             if (map[i][j].is_visited())
                 update(i,j,__collect_unknown);
         }
     }
-    return _Pos_List {__set.begin(),__set.end()};
+    return __list;
+}
+_Tmp_Pos_List collect_adjacent_unknown() {
+    return dispatch_shape([](auto __shape) { return collect_adjacent_unknown(__shape); });
 }
 
 
+template <class _Shape = _Dynamic_Shape>
 bool is_in_range(int x,int y) {
-    return x >= 1 && x <= rows && y >= 1 && y <= columns;
+    return x >= 1 && x <= _Shape::Rows() && y >= 1 && y <= _Shape::Columns();
 }
 bool is_mine(int x,int y) {
     return map[x][y].is_definitely_mine();
@@ -250,23 +579,26 @@ bool may_be_mine(int x,int y) {
 bool may_be_safe(int x,int y) {
     return map[x][y].is_guessed_safe();
 }
+template <class _Shape = _Dynamic_Shape>
 void push_list(int x,int y) {
     update(x,y,[](int x,int y) {
-        if (is_in_range(x,y)) {
+        if (is_in_range <_Shape> (x,y)) {
             work_list.emplace_back(x,y);
         }
     });
 }
+template <class _Shape>
 void mark_possible_mine(int x,int y) {
     if (map[x][y].is_unknown()) {
         map[x][y].set_guess_mine();
-        push_list(x,y);
+        push_list <_Shape> (x,y);
     }
 }
+template <class _Shape>
 void mark_possible_safe(int x,int y) {
     if (map[x][y].is_unknown()) {
         map[x][y].set_guess_safe();
-        push_list(x,y);
+        push_list <_Shape> (x,y);
     }
 }
 
@@ -299,7 +631,8 @@ bool try_update_round(int x,int y) {
  * @return The position of a safe node.
  * If not found, return kNOTFOUND
 */
-_Pos_Type take_safe() {
+template <class _Shape>
+_Pos_Type take_safe(_Shape) {
     while (!work_list.empty()) {
         auto [x , y] = work_list.back();
         work_list.pop_back();
@@ -311,10 +644,13 @@ _Pos_Type take_safe() {
         if (!map[x][y].is_visited()) continue;
 
         /* If success, add to worklist. */
-        if (try_update_round(x,y)) push_list(x,y);
+        if (try_update_round(x,y)) push_list <_Shape> (x,y);
     }
     return kNOTFOUND;
 }
+_Pos_Type take_safe() {
+    return dispatch_shape([](auto __shape) { return take_safe(__shape); });
+}
 
 
 /**
@@ -322,11 +658,13 @@ _Pos_Type take_safe() {
  * Init the worklist before calling this function.
  * @return True iff a contraction is found.
 */
-bool find_contratiction() {
+template <class _Shape>
+bool find_contratiction(_Shape,_Pos_List *__footprint = nullptr) {
     while(!work_list.empty()) {
         auto [x,y] = work_list.back();
         work_list.pop_back();
 
+        if (__footprint) __footprint->emplace_back(x,y);
         if (!map[x][y].is_visited()) continue;
 
         /* Not marked. */
@@ -339,58 +677,137 @@ bool find_contratiction() {
             if (__indicate != __possible) return true;
             else continue;
         } else if (__indicate == __possible + __unknowns) {
-            update(x,y,mark_possible_mine);
+            update(x,y,mark_possible_mine <_Shape>);
         } else if (__indicate == __possible) {
-            update(x,y,mark_possible_safe);
+            update(x,y,mark_possible_safe <_Shape>);
         } else if (__possible > __indicate) {
             return true;
         }
     }
     return false;
 }
+bool find_contratiction() {
+    return dispatch_shape([](auto __shape) { return find_contratiction(__shape); });
+}
+
+
+/**
+ * @brief Cached result of the single-cell hypotheses on one cell.
+ * An entry stays valid until a cell in its footprint changes. The footprint
+ * is every cell the propagation popped, and an entry is registered in the
+ * watchers of those cells, so a change only visits the entries it affects.
+ */
+struct hypothesis_entry {
+    inline static const uint8_t UNDECIDED        = 0;
+    inline static const uint8_t MINE_CONTRADICTS = 1;
+    inline static const uint8_t SAFE_CONTRADICTS = 2;
+
+    uint8_t  result     = UNDECIDED;
+    bool     valid      = false;
+    uint32_t generation = 0; /* Bumped on every recompute, to spot stale watchers. */
+};
+
+inline hypothesis_entry hypothesis[kMAPSIZE][kMAPSIZE] = {};
+inline _Pool_Vector <std::pair <uint32_t,uint32_t>> watchers[kMAPSIZE][kMAPSIZE] = {}; /* (cell, generation) */
+
+inline static _Pos_List footprint = {};
+inline size_t footprint_stamp = 0;
+inline size_t footprint_seen[kMAPSIZE][kMAPSIZE] = {};
 
+void note_change(int x,int y);
+void track_changes();
 
-_Pos_Type guess_mine(const _Pos_List &__list) {
+/* A change at (x,y) may affect every entry that popped a cell around it. */
+void invalidate_hypotheses(int x,int y) {
+    update(x,y,[](int i,int j) {
+        for(auto [__cell , __gen] : watchers[i][j]) {
+            auto &__entry = hypothesis[__cell >> 16][__cell & 0xFFFF];
+            if (__entry.generation == __gen) __entry.valid = false;
+        }
+        watchers[i][j].clear();
+    });
+}
+
+/**
+ * @brief Test one hypothesis on (x,y), appending the popped cells to footprint.
+ * Only cells around the footprint can be marked, so only they are reset.
+ * @return True iff the hypothesis leads to a contradiction.
+ */
+template <class _Shape>
+bool test_hypothesis(int x,int y,bool __mine) {
+    size_t __begin = footprint.size();
     work_list.clear();
-    for(auto [x , y] : __list) {
-        init_guessing();
+    if (__mine) map[x][y].set_guess_mine();
+    else        map[x][y].set_guess_safe();
+    push_list <_Shape> (x,y);
 
-        map[x][y].set_guess_mine();
-        work_list.clear();
-        push_list(x,y);
+    bool __result = find_contratiction(_Shape {},&footprint);
 
-        /* pos(x,y) cannot be a mine! */
-        if (find_contratiction()) return {x,y};
+    map[x][y].reset_guess();
+    for(size_t i = __begin ; i < footprint.size() ; ++i) {
+        auto [u , v] = footprint[i];
+        update(u,v,[](int i,int j) { map[i][j].reset_guess(); });
     }
-    return kNOTFOUND;
+    work_list.clear();
+    return __result;
+}
+
+/* Get the hypothesis result of (x,y), testing again only if outdated. */
+template <class _Shape>
+uint8_t lookup_hypothesis(int x,int y) {
+    auto &__entry = hypothesis[x][y];
+    if (__entry.valid) return __entry.result;
+
+    footprint.clear();
+    if (test_hypothesis <_Shape> (x,y,true))
+        __entry.result = hypothesis_entry::MINE_CONTRADICTS;
+    else if (test_hypothesis <_Shape> (x,y,false))
+        __entry.result = hypothesis_entry::SAFE_CONTRADICTS;
+    else
+        __entry.result = hypothesis_entry::UNDECIDED;
+    __entry.valid = true;
+    __entry.generation += 1;
+
+    ++footprint_stamp;
+    footprint.emplace_back(x,y);
+    for(auto [u , v] : footprint) {
+        if (footprint_seen[u][v] == footprint_stamp) continue;
+        footprint_seen[u][v] = footprint_stamp;
+        watchers[u][v].emplace_back(pack_pos(x,y),__entry.generation);
+    }
+    return __entry.result;
 }
 
 
-_Pos_Type guess_safe(const _Pos_List &__list) {
-    _Pos_List __updated = {};
+template <class _Shape>
+_Pos_Type guess_mine(const _Tmp_Pos_List &__list) {
+    work_list.clear();
     for(auto [x , y] : __list) {
-        init_guessing();
+        /* pos(x,y) cannot be a mine! */
+        if (lookup_hypothesis <_Shape> (x,y) == hypothesis_entry::MINE_CONTRADICTS) return {x,y};
+    }
+    return kNOTFOUND;
+}
 
-        map[x][y].set_guess_safe();
-        work_list.clear();
-        push_list(x,y);
 
+template <class _Shape>
+_Pos_Type guess_safe(const _Tmp_Pos_List &__list) {
+    _Tmp_Pos_List __updated = {};
+    for(auto [x , y] : __list) {
         /* pos(x,y) must be a mine! */
-        if (find_contratiction()) {
+        if (lookup_hypothesis <_Shape> (x,y) == hypothesis_entry::SAFE_CONTRADICTS) {
             map[x][y].set_mine();
+            note_change(x,y);
             __updated.emplace_back(x,y);
         }
     }
 
-    /* No guessing state is needed. */
-    init_guessing();
-
     if (__updated.empty()) {
         work_list.resize(1);
         return kNOTFOUND;
     } else {
-        work_list = std::move(__updated);
-        return take_safe();
+        work_list.assign(__updated.begin(),__updated.end());
+        return take_safe(_Shape {});
     }
 }
 
@@ -408,16 +825,15 @@ void set_contradiction(_Node_Type __lhs,_Node_Type __rhs) {
 }
 
 
-_Node_Set dfs(_Node_Type __cur) {
-    _Node_Set visited = {};
-    std::vector <_Node_Type> stack = {};
-    auto &__ref = graph.at(__cur);
+_Flat_Set dfs(_Node_Type __cur) {
+    _Flat_Set visited = {};
+    _Arena_Vector <_Node_Type> stack = {};
     stack.push_back(__cur);
 
     while (!stack.empty()) {
         auto __top = stack.back();
         stack.pop_back();
-        if (!visited.emplace(__top).second) continue;
+        if (!visited.insert(pack_node(__top))) continue;
 
         auto __iter = graph.find(__top);
         if (__iter == graph.end()) continue;
@@ -429,7 +845,7 @@ _Node_Set dfs(_Node_Type __cur) {
 }
 
 
-_Pos_Type build_graph(_Pos_List &__list) {
+_Pos_Type build_graph(_Tmp_Pos_List &__list) {
     for(auto [x , y] : __list) {
         _Node_Type __cur = {x,y};
         __cur.flag  = true;
@@ -437,16 +853,14 @@ _Pos_Type build_graph(_Pos_List &__list) {
         if (__mine == graph.end()) continue;
         __cur.flag  = false;
 
-        __mine->second = dfs(__mine->first);
-
         /* Add to the contra list! */
-        if (__mine->second.count(__cur)) return {x,y};
+        if (dfs(__mine->first).contains(pack_node(__cur))) return {x,y};
     }
     return kNOTFOUND;
 }
 
 
-_Pos_Type guess_double(_Pos_List &__list) {
+_Pos_Type guess_double(_Tmp_Pos_List &__list) {
     graph.clear();
     work_list.clear();
     for(size_t i = 0 ; i < __list.size() ; ++i) {
@@ -505,18 +919,33 @@ _Pos_Type guess_double(_Pos_List &__list) {
 }
 
 
-_Pos_Type guessing() {
-    std::cerr << "Guess single!\n";
+/**
+ * @brief Single-cell guessing pass.
+ * Results are cached across moves, so only cells near the changes are tested.
+ */
+template <class _Shape>
+_Pos_Type guess_single(_Shape __shape) {
     do {
-        _Pos_List __list = collect_adjacent_unknown();
-        if (auto [x , y] = guess_mine(__list); x != 0) return {x,y};
-        if (auto [x , y] = guess_safe(__list); x != 0) return {x,y};
+        track_changes(__shape);
+        _Tmp_Pos_List __list = collect_adjacent_unknown(__shape);
+        if (auto [x , y] = guess_mine <_Shape> (__list); x != 0) return {x,y};
+        if (auto [x , y] = guess_safe <_Shape> (__list); x != 0) return {x,y};
     } while(work_list.empty());
+    return kNOTFOUND;
+}
+_Pos_Type guess_single() {
+    return dispatch_shape([](auto __shape) { return guess_single(__shape); });
+}
+
+
+_Pos_Type guessing() {
+    std::cerr << "Guess single!\n";
+    if (auto [x , y] = guess_single(); x != 0) return {x,y};
     init_guessing();
 
     /* Single guess failed! */
     std::cerr << "Guess double!\n";
-    _Pos_List __list = collect_adjacent_unknown();
+    _Tmp_Pos_List __list = collect_adjacent_unknown();
     if (auto [x , y] = guess_double(__list); x != 0) return {x,y};
     bool     __flag = false;
     _Pos_Type __ans = {0,0};
@@ -543,46 +972,868 @@ double calc_prob(int x,int y) {
     return (__indicate - __detected) / static_cast <double> (__unknowns);
 }
 
+/**
+ * @brief A connected region of the frontier.
+ * Cells are the unknown blocks in the region, and constraints are the visited
+ * blocks around them. Enumeration results are kept across moves, until some
+ * change near the region sets the dirty flag.
+ */
+struct frontier_component {
+    _Pool_Vector <_Pos_Type> cells       = {}; /* Unknown cells of the region.             */
+    _Pool_Vector <_Pos_Type> constraints = {}; /* Visited cells bounding the region.       */
+    bool                     dirty       = {}; /* Whether the cached results are outdated. */
+    bool                     solved      = {}; /* Whether the enumeration has finished.    */
+
+    _Pool_Vector <double> count  = {}; /* count[k]  : solutions with k mines.            */
+    _Pool_Vector <double> weight = {}; /* weight[k * n + i] : those with cell i as mine.  */
+
+    bool is_alive() const noexcept { return !cells.empty(); }
+
+    /* Drop the content, but keep the storage for reuse. */
+    void clear() noexcept {
+        cells.clear();
+        constraints.clear();
+        count.clear();
+        weight.clear();
+        dirty  = false;
+        solved = false;
+    }
+};
+
+inline static constexpr size_t kENUM_LIMIT = 1 << 22;
+
+inline static std::vector <frontier_component> components = {};
+inline static std::vector <int> free_components = {};
+
+inline int    owner[kMAPSIZE][kMAPSIZE]         = {}; /* Index + 1 of the component, 0 if none. */
+inline state  snapshot[kMAPSIZE][kMAPSIZE]      = {}; /* Map state when last refreshed.         */
+inline double frontier_prob[kMAPSIZE][kMAPSIZE] = {}; /* Mine probability, negative if unknown. */
+inline bool   frontier_fresh = false; /* Whether frontier_prob matches the map since the last move. */
+
+
+/* Mark the components around (x,y) as dirty. */
+void touch_component(int x,int y) {
+    update(x,y,[](int x,int y) {
+        if (int __id = owner[x][y]) components[__id - 1].dirty = true;
+    });
+}
+
+/* Drop a component and all of its ownership. */
+void release_component(int __id) {
+    auto &__comp = components[__id - 1];
+    for(auto [x , y] : __comp.cells)       owner[x][y] = 0;
+    for(auto [x , y] : __comp.constraints) owner[x][y] = 0;
+    __comp.clear();
+    free_components.push_back(__id);
+}
+
+/* Collect the region connected to (x,y) into component __id. */
+template <class _Shape>
+void build_component(int x,int y,int __id) {
+    auto &__comp = components[__id - 1];
+    owner[x][y] = __id;
+    __comp.cells.emplace_back(x,y);
+    for(size_t __n = 0 ; __n < __comp.cells.size() ; ++__n) {
+        auto [cx , cy] = __comp.cells[__n];
+        update(cx,cy,[&](int i,int j) {
+            if (!is_in_range <_Shape> (i,j) || !map[i][j].is_visited() || owner[i][j]) return;
+            owner[i][j] = __id;
+            __comp.constraints.emplace_back(i,j);
+            update(i,j,[&](int u,int v) {
+                if (!map[u][v].is_unknown() || owner[u][v]) return;
+                owner[u][v] = __id;
+                __comp.cells.emplace_back(u,v);
+            });
+        });
+    }
+}
+
+/**
+ * @brief Prepare the constraints of a component for a search.
+ * __need and __left are the mines and unknown cells left around each
+ * constraint, and __links[i * 8 + k] (k < __degree[i]) are those of cell i.
+ */
+template <class _Vec>
+void link_component(const frontier_component &__comp,
+                    _Vec &__need,_Vec &__left,_Vec &__links,_Vec &__degree) {
+    const size_t __n = __comp.cells.size();
+    const size_t __m = __comp.constraints.size();
+    __need.assign(__m,0);
+    __left.assign(__m,0);
+    __links.assign(__n * 8,0);
+    __degree.assign(__n,0);
+
+    for(size_t j = 0 ; j < __m ; ++j) {
+        auto [x , y] = __comp.constraints[j];
+        __need[j] = map[x][y].get_mine_count() - count_if(x,y,is_mine);
+        __left[j] = count_if(x,y,is_unknown);
+    }
+    for(size_t i = 0 ; i < __n ; ++i) {
+        auto [x , y] = __comp.cells[i];
+        for(size_t j = 0 ; j < __m ; ++j) {
+            auto [u , v] = __comp.constraints[j];
+            if (std::abs(u - x) <= 1 && std::abs(v - y) <= 1) __links[i * 8 + __degree[i]++] = j;
+        }
+    }
+}
+
+/**
+ * @brief Count all mine layouts of a component.
+ * Backtracking over cells in BFS order, which keeps constraints tight.
+ * If there are too many search steps, the component is left unsolved.
+ */
+void enumerate_component(frontier_component &__comp) {
+    const size_t __n = __comp.cells.size();
+    const size_t __m = __comp.constraints.size();
+
+    _Arena_Vector <int> __need, __left, __assigned(__m);
+    _Arena_Vector <int> __links, __degree;
+    _Arena_Vector <uint8_t> __value(__n);
+    link_component(__comp,__need,__left,__links,__degree);
+
+    __comp.count.assign(__n + 1, 0.0);
+    __comp.weight.assign((__n + 1) * __n, 0.0);
+
+    size_t __steps = 0;
+    auto &&__dfs = [&](auto &&__self,size_t i,size_t __mines) -> bool {
+        if (++__steps > kENUM_LIMIT) return false;
+        if (i == __n) {
+            __comp.count[__mines] += 1;
+            for(size_t k = 0 ; k < __n ; ++k)
+                __comp.weight[__mines * __n + k] += __value[k];
+            return true;
+        }
+        for(uint8_t __val = 0 ; __val <= 1 ; ++__val) {
+            bool __valid = true;
+            for(int __k = 0 ; __k < __degree[i] ; ++__k) {
+                int j = __links[i * 8 + __k];
+                __left[j] -= 1;
+                __assigned[j] += __val;
+                if (__assigned[j] > __need[j] || __assigned[j] + __left[j] < __need[j])
+                    __valid = false;
+            }
+            __value[i] = __val;
+            bool __done = !__valid || __self(__self,i + 1,__mines + __val);
+            for(int __k = 0 ; __k < __degree[i] ; ++__k) {
+                int j = __links[i * 8 + __k];
+                __left[j] += 1;
+                __assigned[j] -= __val;
+            }
+            if (!__done) return false;
+        }
+        return true;
+    };
+
+    __comp.solved = __dfs(__dfs,0,0);
+    if (std::all_of(__comp.count.begin(),__comp.count.end(),[](double __c) { return __c == 0; }))
+        __comp.solved = false; /* Contradiction, no exact result. */
+    __comp.dirty = false;
+}
+
+/* Record a change of (x,y), so that caches depending on it are dropped. */
+void note_change(int x,int y) {
+    touch_component(x,y);
+    invalidate_hypotheses(x,y);
+    snapshot[x][y] = map[x][y];
+}
+
+/* Find the changes since the last call, by diffing map with snapshot. */
+template <class _Shape>
+void track_changes(_Shape) {
+    for(int i = 1 ; i <= _Shape::Rows() ; ++i) {
+        for(int j = 1 ; j <= _Shape::Columns() ; ++j) {
+            if (map[i][j] != snapshot[i][j]) note_change(i,j);
+        }
+    }
+}
+void track_changes() {
+    dispatch_shape([](auto __shape) { track_changes(__shape); });
+}
+
+/**
+ * @brief Bring the frontier components up to date.
+ * Only components around the changed blocks are enumerated again,
+ * clean ones keep their cached results.
+ */
+template <class _Shape>
+void refresh_components(_Shape __shape) {
+    track_changes(__shape);
+
+    for(size_t __id = 1 ; __id <= components.size() ; ++__id) {
+        auto &__comp = components[__id - 1];
+        if (__comp.is_alive() && __comp.dirty) release_component(__id);
+    }
+
+    auto &&__has_visited = [](int x,int y) -> bool {
+        return is_in_range <_Shape> (x,y) && map[x][y].is_visited();
+    };
+    for(int i = 1 ; i <= _Shape::Rows() ; ++i) {
+        for(int j = 1 ; j <= _Shape::Columns() ; ++j) {
+            if (!map[i][j].is_unknown() || owner[i][j] || !count_if(i,j,__has_visited)) continue;
+            int __id;
+            if (free_components.empty()) {
+                components.emplace_back();
+                __id = components.size();
+            } else {
+                __id = free_components.back();
+                free_components.pop_back();
+            }
+            build_component <_Shape> (i,j,__id);
+            enumerate_component(components[__id - 1]);
+        }
+    }
+}
+
+/**
+ * @brief Combine the cached counts into mine probabilities.
+ * Without the total mine count, layouts with k mines in a component are
+ * weighted by (p / (1 - p)) ^ k, where p is the global average.
+ */
+template <class _Shape>
+void combine_components(_Shape) {
+    for(int i = 1 ; i <= _Shape::Rows() ; ++i)
+        for(int j = 1 ; j <= _Shape::Columns() ; ++j)
+            frontier_prob[i][j] = -1.0;
+
+    const double __ratio = global_average / (1.0 - global_average);
+    for(auto &__comp : components) {
+        if (!__comp.is_alive() || !__comp.solved) continue;
+        const size_t __n = __comp.cells.size();
+
+        double __total = 0.0, __power = 1.0;
+        _Arena_Vector <double> __mass(__n, 0.0);
+        for(size_t k = 0 ; k <= __n ; ++k , __power *= __ratio) {
+            __total += __comp.count[k] * __power;
+            for(size_t i = 0 ; i < __n ; ++i)
+                __mass[i] += __comp.weight[k * __n + i] * __power;
+        }
+        for(size_t i = 0 ; i < __n ; ++i) {
+            auto [x , y] = __comp.cells[i];
+            frontier_prob[x][y] = __mass[i] / __total;
+        }
+    }
+    frontier_fresh = true;
+}
+
+/**
+ * @brief Pool of worker threads, running one job on all of them at a time.
+ * The calling thread takes part as worker 0.
+ */
+class _Thread_Pool {
+  private:
+    std::vector <std::thread>      workers = {};
+    std::mutex                     mutex   = {};
+    std::condition_variable        wake    = {};
+    std::condition_variable        done    = {};
+    std::function <void(size_t)>   job     = {};
+    size_t generation = 0;
+    size_t running    = 0;
+    bool   stop       = false;
+
+    void work(size_t __index) {
+        size_t __seen = 0;
+        while (true) {
+            {
+                std::unique_lock <std::mutex> __lock(mutex);
+                wake.wait(__lock,[&] { return stop || generation != __seen; });
+                if (stop) return;
+                __seen = generation;
+            }
+            job(__index);
+            std::lock_guard <std::mutex> __lock(mutex);
+            if (--running == 0) done.notify_one();
+        }
+    }
+
+  public:
+    explicit _Thread_Pool(size_t __count) {
+        for(size_t i = 1 ; i < __count ; ++i)
+            workers.emplace_back(&_Thread_Pool::work,this,i);
+    }
+    ~_Thread_Pool() {
+        {
+            std::lock_guard <std::mutex> __lock(mutex);
+            stop = true;
+        }
+        wake.notify_all();
+        for(auto &__worker : workers) __worker.join();
+    }
+
+    size_t size() const noexcept { return workers.size() + 1; }
+
+    /* Run __job(i) for every i < size(), and wait for all of them. */
+    template <class _Func>
+    void run(_Func &&__job) {
+        {
+            std::lock_guard <std::mutex> __lock(mutex);
+            job     = [&__job](size_t i) { __job(i); };
+            running = workers.size();
+            ++generation;
+        }
+        wake.notify_all();
+        __job(0);
+        std::unique_lock <std::mutex> __lock(mutex);
+        done.wait(__lock,[&] { return running == 0; });
+        job = nullptr;
+    }
+};
+
+/* Threads for lookahead, one per core if zero. Read once, on the first lookahead. */
+inline size_t lookahead_threads = 0;
+
+inline _Thread_Pool &thread_pool() {
+    static _Thread_Pool __pool(lookahead_threads != 0 ? lookahead_threads
+                             : std::max(1u,std::thread::hardware_concurrency()));
+    return __pool;
+}
+
+
+inline static constexpr size_t kLOOKAHEAD_CANDIDATES = 8;    /* Guesses compared at most.              */
+inline static constexpr double kLOOKAHEAD_SLACK      = 0.05; /* Extra risk over the safest guess.      */
+inline static constexpr size_t kLOOKAHEAD_SAMPLES    = 64;   /* Sampled boards per guess.              */
+inline static constexpr size_t kLOOKAHEAD_DEPTH      = 64;   /* Forced moves at most per rollout.      */
+inline static constexpr size_t kSAMPLE_LIMIT         = 1 << 16;
+
+/* Count of lookaheads in this game, which seeds their samples. */
+inline size_t lookahead_round = 0;
+
+/* Wall-clock limit of one lookahead, none if zero. Opt-in only, as it makes the guesses depend on timing. */
+inline std::chrono::milliseconds lookahead_budget = std::chrono::milliseconds(0);
+
+using _State_Map = state[kMAPSIZE][kMAPSIZE];
+
+/**
+ * @brief A board the player imagines, for lookahead.
+ * It holds the blocks seen so far and the mines of one sampled layout, and
+ * follows the rules of the game, so forced moves can be played on it.
+ * Rows are copy-on-write: a copy costs one pointer per row, and the first
+ * write to a row after a copy clones that row only. Blocks are indexed as
+ * in map, and the padding reads as visited, so no bounds checks are needed.
+ */
+class _Sample_Board {
+  private:
+    inline static constexpr uint8_t kVISITED = 0x80; /* Flag of a visited block.      */
+    inline static constexpr uint8_t kMINE    = 0x0F; /* Count stored for a mine.      */
+
+    using _Row = std::array <uint8_t,kMAPSIZE>;
+
+    std::array <std::shared_ptr <_Row>,kMAPSIZE> board = {};
+    int result = 0; /* 0 if going on, 1 if won, -1 if a mine is hit. */
+    int visits = 0; /* Visited safe blocks.                          */
+    int safes  = 0; /* Safe blocks in all.                           */
+
+    uint8_t get(int x,int y) const noexcept { return (*board[x])[y]; }
+    void set(int x,int y,uint8_t __val) {
+        auto &__row = board[x];
+        if ((*__row)[y] == __val) return;
+        if (__row.use_count() > 1) __row = std::allocate_shared <_Row> (_Pool_Allocator <_Row> (),*__row);
+        (*__row)[y] = __val;
+    }
+
+  public:
+    _Sample_Board() = default;
+
+    /* A board of unknown blocks without any mine. All inner rows share one. */
+    _Sample_Board(int __rows,int __cols) : safes(__rows * __cols) {
+        auto __edge  = std::allocate_shared <_Row> (_Pool_Allocator <_Row> ());
+        auto __inner = std::allocate_shared <_Row> (_Pool_Allocator <_Row> ());
+        __edge->fill(kVISITED);
+        __inner->fill(kVISITED);
+        std::fill(__inner->begin() + 1,__inner->begin() + __cols + 1,uint8_t(0));
+        for(int i = 0 ; i <= __rows + 1 ; ++i)
+            board[i] = (i == 0 || i == __rows + 1) ? __edge : __inner;
+    }
+
+    /* Mark (x,y) as visited with the count the player has seen, without flooding. */
+    void reveal(int x,int y,int __count) {
+        if (get(x,y) & kVISITED) return;
+        set(x,y,kVISITED | __count);
+        ++visits;
+    }
+
+    /* Place a mine on an unvisited block, and count it in the unvisited blocks around. */
+    void place_mine(int x,int y) {
+        if ((get(x,y) & kVISITED) || get(x,y) == kMINE) return;
+        set(x,y,kMINE);
+        --safes;
+        update(x,y,[&](int i,int j) {
+            uint8_t __cur = get(i,j);
+            if (!(__cur & kVISITED) && __cur != kMINE) set(i,j,__cur + 1);
+        });
+    }
+
+    /**
+     * @brief Visit (x,y) by the rules of the game.
+     * Every safe block it opens is appended to __revealed.
+     */
+    void visit(int x,int y,_Pos_List &__revealed) {
+        thread_local _Pos_List __stack; /* Reused, so a warm thread does not allocate. */
+        if (get(x,y) & kVISITED) return;
+        if (get(x,y) == kMINE) {
+            result = -1;
+            return;
+        }
+        __stack.assign(1,{x,y});
+        while (!__stack.empty()) {
+            auto [u , v] = __stack.back();
+            __stack.pop_back();
+            uint8_t __cur = get(u,v);
+            if (__cur & kVISITED) continue;
+            set(u,v,__cur | kVISITED);
+            ++visits;
+            __revealed.emplace_back(u,v);
+            /* Blocks next to a 0 are never mines. */
+            if (__cur == 0) update(u,v,[&](int i,int j) {
+                if (!(get(i,j) & kVISITED)) __stack.emplace_back(i,j);
+            });
+        }
+        if (visits == safes) result = 1;
+    }
+
+    int get_mine_count(int x,int y) const noexcept { return get(x,y) & kMINE; }
+    int get_result() const noexcept { return result; }
+    int get_visits() const noexcept { return visits; }
+};
+
+/**
+ * @brief The board as the player sees it: the visited blocks and the known mines.
+ * Built once per lookahead, then copied for every sampled layout.
+ */
+template <class _Shape>
+_Sample_Board seen_board() {
+    _Sample_Board __board(_Shape::Rows(),_Shape::Columns());
+    for(int i = 1 ; i <= _Shape::Rows() ; ++i) {
+        for(int j = 1 ; j <= _Shape::Columns() ; ++j) {
+            if (map[i][j].is_visited()) __board.reveal(i,j,map[i][j].get_mine_count());
+        }
+    }
+    for(int i = 1 ; i <= _Shape::Rows() ; ++i) {
+        for(int j = 1 ; j <= _Shape::Columns() ; ++j) {
+            if (map[i][j].is_definitely_mine()) __board.place_mine(i,j);
+        }
+    }
+    return __board;
+}
+
+/**
+ * @brief Sample a mine layout consistent with map, on a copy of the seen board.
+ * Frontier components are filled by randomized backtracking, which tries the
+ * likelier value first. Other unknown cells are mines by the global average.
+ * Layouts are always consistent, but only roughly follow the true distribution.
+ * @return False if some component needs too many search steps.
+ */
+template <class _Shape>
+bool sample_layout(std::mt19937_64 &__rng,const _Sample_Board &__seen,_Sample_Board &__board) {
+    thread_local std::vector <int> __need, __left, __assigned, __links, __degree;
+    thread_local std::vector <uint8_t> __value;
+    std::uniform_real_distribution <double> __coin(0.0,1.0);
+
+    __board = __seen;
+    for(auto &__comp : components) {
+        if (!__comp.is_alive()) continue;
+        const size_t __n = __comp.cells.size();
+        link_component(__comp,__need,__left,__links,__degree);
+        __assigned.assign(__comp.constraints.size(),0);
+        __value.assign(__n,0);
+
+        size_t __steps = 0;
+        auto &&__dfs = [&](auto &&__self,size_t i) -> bool {
+            if (i == __n) return true;
+            if (++__steps > kSAMPLE_LIMIT) return false;
+            auto [x , y] = __comp.cells[i];
+            double  __prob  = frontier_prob[x][y] >= 0 ? frontier_prob[x][y] : global_average;
+            uint8_t __first = __coin(__rng) < __prob;
+            for(uint8_t __val : {__first,uint8_t(!__first)}) {
+                bool __valid = true;
+                for(int __k = 0 ; __k < __degree[i] ; ++__k) {
+                    int j = __links[i * 8 + __k];
+                    __left[j] -= 1;
+                    __assigned[j] += __val;
+                    if (__assigned[j] > __need[j] || __assigned[j] + __left[j] < __need[j])
+                        __valid = false;
+                }
+                __value[i] = __val;
+                bool __found = __valid && __self(__self,i + 1);
+                for(int __k = 0 ; __k < __degree[i] ; ++__k) {
+                    int j = __links[i * 8 + __k];
+                    __left[j] += 1;
+                    __assigned[j] -= __val;
+                }
+                if (__found) return true;
+                if (__steps > kSAMPLE_LIMIT) return false;
+            }
+            return false;
+        };
+        if (!__dfs(__dfs,0)) return false;
+        for(size_t i = 0 ; i < __n ; ++i) {
+            auto [x , y] = __comp.cells[i];
+            if (__value[i]) __board.place_mine(x,y);
+        }
+    }
+
+    for(int i = 1 ; i <= _Shape::Rows() ; ++i) {
+        for(int j = 1 ; j <= _Shape::Columns() ; ++j) {
+            if (map[i][j].is_unknown() && !owner[i][j] && __coin(__rng) < global_average)
+                __board.place_mine(i,j);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Reveal (x,y) on a copy of the board, then play the forced moves of take_safe.
+ * map starts from __seen, and only the blocks each visit opens are read into
+ * it and pushed to work_list, so a forced move costs what it reveals.
+ * @return The count of blocks gained, 0 if (x,y) is a mine.
+ */
+template <class _Shape>
+size_t rollout(const _State_Map &__seen,const _Sample_Board &__base,int x,int y) {
+    thread_local _Pos_List __revealed;
+    std::copy(&__seen[0][0],&__seen[0][0] + (_Shape::Rows() + 2) * kMAPSIZE,&map[0][0]);
+    work_list.clear();
+
+    _Sample_Board __board = __base;
+    auto &&__visit = [&](int u,int v) {
+        __revealed.clear();
+        __board.visit(u,v,__revealed);
+        for(auto [i , j] : __revealed) map[i][j].set_visited(__board.get_mine_count(i,j));
+        for(auto [i , j] : __revealed) push_list <_Shape> (i,j);
+    };
+    __visit(x,y);
+    for(size_t __step = 0 ; __board.get_result() == 0 && __step < kLOOKAHEAD_DEPTH ; ++__step) {
+        auto [u , v] = take_safe(_Shape {});
+        if (u == 0) break;
+        __visit(u,v);
+    }
+    if (__board.get_result() == -1) return 0;
+    return __board.get_visits() - __base.get_visits();
+}
+
+/**
+ * @brief Choose among the safest guesses by lookahead.
+ * Each candidate is played forward on kLOOKAHEAD_SAMPLES boards sampled in
+ * parallel, and scored by its survival probability times the blocks it is
+ * expected to gain when safe. Sample i always uses the same seed, and the
+ * sums are exact, so the result depends on neither timing nor thread count,
+ * unless lookahead_budget cuts it short.
+ * @param __candidates Pairs of risk and position, the safest first.
+ */
+template <class _Shape>
+_Pos_Type lookahead(const _Arena_Vector <std::pair <double,_Pos_Type>> &__candidates) {
+    const size_t __round = ++lookahead_round;
+
+    const size_t __k     = __candidates.size();
+    const bool __timed   = lookahead_budget.count() > 0;
+    const auto __expire  = std::chrono::steady_clock::now() + lookahead_budget;
+    auto &__pool         = thread_pool();
+
+    _Arena_Vector <state>  __base(&map[0][0],&map[0][0] + kMAPSIZE * kMAPSIZE);
+    const _Sample_Board    __seen = seen_board <_Shape> ();
+    _Arena_Vector <double> __gain(__pool.size() * __k,0.0);
+    _Arena_Vector <double> __safe(__pool.size() * __k,0.0);
+    std::atomic <size_t>   __next = 0;
+
+    __pool.run([&](size_t __index) {
+        auto &__map = reinterpret_cast <const _State_Map &> (*__base.data());
+        _Sample_Board __board;
+        size_t __sample;
+        while ((__sample = __next++) < kLOOKAHEAD_SAMPLES
+            && (!__timed || std::chrono::steady_clock::now() < __expire)) {
+            std::copy(&__map[0][0],&__map[0][0] + (_Shape::Rows() + 2) * kMAPSIZE,&map[0][0]);
+            std::mt19937_64 __rng(__round * kLOOKAHEAD_SAMPLES + __sample);
+            if (!sample_layout <_Shape> (__rng,__seen,__board)) continue;
+            for(size_t c = 0 ; c < __k ; ++c) {
+                auto [x , y] = __candidates[c].second;
+                if (size_t __blocks = rollout <_Shape> (__map,__board,x,y)) {
+                    __gain[__index * __k + c] += __blocks;
+                    __safe[__index * __k + c] += 1;
+                }
+            }
+        }
+    });
+    std::copy(__base.begin(),__base.end(),&map[0][0]);
+
+    double    __best = -1.0;
+    _Pos_Type __ans  = __candidates[0].second;
+    for(size_t c = 0 ; c < __k ; ++c) {
+        double __gained = 0.0, __times = 0.0;
+        for(size_t i = 0 ; i < __pool.size() ; ++i) {
+            __gained += __gain[i * __k + c];
+            __times  += __safe[i * __k + c];
+        }
+        if (__times == 0) continue;
+        double __score = (1.0 - __candidates[c].first) * (__gained / __times);
+        if (__score > __best) __best = __score , __ans = __candidates[c].second;
+    }
+    return __ans;
+}
+
 double __prob[kMAPSIZE][kMAPSIZE] = {};
 
-_Pos_Type take_random() {
-    // double    __min = 1.0;
-    // _Pos_Type __ans = {1,1};
+template <class _Shape>
+_Pos_Type take_random(_Shape __shape) {
     std::cerr << "Take risk!\n";
 
     double __tmp = 0.0;
-    for(int i = 1 ; i <= rows ; ++i) {
-        for(int j = 1 ; j <= columns ; ++j) {
+    for(int i = 1 ; i <= _Shape::Rows() ; ++i) {
+        for(int j = 1 ; j <= _Shape::Columns() ; ++j) {
             __prob[i][j] = calc_prob(i,j);
         }
     }
     auto &&__amort_prob = [&](int x,int y) -> void {
-        if (is_in_range(x,y) && __prob[x][y] != global_average ) {
+        if (is_in_range <_Shape> (x,y) && __prob[x][y] != global_average ) {
             __tmp = std::max(__tmp,__prob[x][y]);
         }
     };
-    std::vector <std::pair <double,_Pos_Type>> __list = {};
-    for(int i = 1 ; i <= rows ; ++i) {
-        for(int j = 1 ; j <= columns ; ++j) {
+    refresh_components(__shape);
+    combine_components(__shape);
+    double __min = 2.0;
+    _Arena_Vector <std::pair <double,_Pos_Type>> __list = {};
+    for(int i = 1 ; i <= _Shape::Rows() ; ++i) {
+        for(int j = 1 ; j <= _Shape::Columns() ; ++j) {
             if (map[i][j].is_unknown()) {
                 __tmp = global_average;
                 update(i,j,__amort_prob);
+                if (frontier_prob[i][j] >= 0) __tmp = frontier_prob[i][j];
+                __min = std::min(__min,__tmp);
                 __list.emplace_back(__tmp,std::make_pair(i,j));
             }
         }
     }
-    std::sort (__list.begin(),__list.end(),[](const auto &__a,const auto &__b) {
-        return __a.first < __b.first;
-    });
-    return __list[0].second;
+
+    /* Only guesses nearly as safe as the safest one are worth a lookahead. */
+    __list.erase(std::remove_if(__list.begin(),__list.end(),[&](const auto &__p) {
+        return __p.first > __min + kLOOKAHEAD_SLACK;
+    }),__list.end());
+    std::sort(__list.begin(),__list.end());
+    if (__list.size() > kLOOKAHEAD_CANDIDATES) __list.resize(kLOOKAHEAD_CANDIDATES);
+    if (__list.size() == 1) return __list[0].second;
+    return lookahead <_Shape> (__list);
+}
+_Pos_Type take_random() {
+    return dispatch_shape([](auto __shape) { return take_random(__shape); });
+}
+
+/**
+ * @brief One background thread, running one job at a time.
+ */
+class _Background_Worker {
+  private:
+    std::mutex              mutex  = {};
+    std::condition_variable cv     = {};
+    std::function <void()>  job    = {};
+    bool busy = false;
+    bool stop = false;
+    std::thread             thread = {}; /* Last, so it starts after the others. */
+
+    void loop() {
+        std::unique_lock <std::mutex> __lock(mutex);
+        while (true) {
+            cv.wait(__lock,[&] { return stop || busy; });
+            if (stop) return;
+            __lock.unlock();
+            job();
+            __lock.lock();
+            busy = false;
+            cv.notify_all();
+        }
+    }
+
+  public:
+    _Background_Worker() : thread(&_Background_Worker::loop,this) {}
+    ~_Background_Worker() {
+        wait();
+        {
+            std::lock_guard <std::mutex> __lock(mutex);
+            stop = true;
+        }
+        cv.notify_all();
+        thread.join();
+    }
+
+    /* Start a job. The previous one must have finished. */
+    template <class _Func>
+    void start(_Func &&__job) {
+        std::lock_guard <std::mutex> __lock(mutex);
+        job  = std::forward <_Func> (__job);
+        busy = true;
+        cv.notify_all();
+    }
+    /* Wait until the current job, if any, has finished. */
+    void wait() {
+        std::unique_lock <std::mutex> __lock(mutex);
+        cv.wait(__lock,[&] { return !busy; });
+    }
+};
+
+inline _Background_Worker &speculation_worker() {
+    static _Background_Worker __worker;
+    return __worker;
+}
+
+/**
+ * @brief Whether to solve in the background while the server handles a move.
+ * Off by default, as it needs one more core. A program turns it on by
+ * defining CLIENT_SPECULATE as 1 before including this header.
+ */
+#ifndef CLIENT_SPECULATE
+#define CLIENT_SPECULATE 0
+#endif
+inline static constexpr bool kSPECULATE = CLIENT_SPECULATE;
+
+inline state     speculated_map[kMAPSIZE][kMAPSIZE] = {}; /* Map when the move was sent.       */
+inline _Pos_Type speculated_move  = kNOTFOUND;             /* The pending move.                 */
+inline uint8_t   speculated_count = 0;                     /* Its most likely count, 0 if none. */
+inline static _Pos_List speculated_safe    = {}; /* Safe whatever the move reveals.     */
+inline static _Pos_List conditional_safe   = {}; /* Safe if it reveals speculated_count. */
+inline static _Pos_List pending_safe       = {}; /* Committed safe cells, not yet played. */
+inline bool             pending_mark[kMAPSIZE][kMAPSIZE] = {};
+
+/* Drain take_safe on the worker's own map, collecting every safe cell but (x,y). */
+template <class _Shape>
+void speculate_drain(_Pos_List &__out,int x,int y) {
+    while (true) {
+        auto [u , v] = take_safe(_Shape {});
+        if (u == 0) return;
+        if (u != x || v != y) __out.emplace_back(u,v);
+    }
+}
+
+/* The job of the worker: solve the map before the move, then after its likely reveal. */
+template <class _Shape>
+void speculate_job(_Shape) {
+    std::copy(&speculated_map[0][0],&speculated_map[0][0] + kMAPSIZE * kMAPSIZE,&map[0][0]);
+    auto [x , y] = speculated_move;
+    speculated_safe.clear();
+    conditional_safe.clear();
+
+    work_list.clear();
+    for(int i = 1 ; i <= _Shape::Rows() ; ++i) {
+        for(int j = 1 ; j <= _Shape::Columns() ; ++j) {
+            map[i][j].reset_guess();
+            if (map[i][j].is_visited()) work_list.emplace_back(i,j);
+        }
+    }
+    speculate_drain <_Shape> (speculated_safe,x,y);
+
+    if (speculated_count == 0) return;
+    map[x][y].set_visited(speculated_count);
+    work_list.clear();
+    push_list <_Shape> (x,y);
+    speculate_drain <_Shape> (conditional_safe,x,y);
+}
+void speculate_job() {
+    dispatch_shape([](auto __shape) { speculate_job(__shape); });
+}
+
+/**
+ * @brief Start solving in the background, before the move (x,y) is sent.
+ * Guesses the count (x,y) will show from the known mines and probabilities
+ * around it. A count of 0 would flood, so it is not speculated on, and
+ * neither is any count when the probabilities are from an older map.
+ */
+void speculate_begin(int x,int y) {
+    auto &__worker = speculation_worker();
+    __worker.wait();
+
+    double __expect = 0.0;
+    if (frontier_fresh) {
+        update(x,y,[&](int i,int j) {
+            if (!is_in_range(i,j) || (i == x && j == y)) return;
+            if (map[i][j].is_definitely_mine()) __expect += 1.0;
+            else if (map[i][j].is_unknown())
+                __expect += frontier_prob[i][j] >= 0 ? frontier_prob[i][j] : global_average;
+        });
+    }
+    std::copy(&map[0][0],&map[0][0] + kMAPSIZE * kMAPSIZE,&speculated_map[0][0]);
+    speculated_move  = {x,y};
+    speculated_count = static_cast <uint8_t> (std::lround(__expect));
+    __worker.start([] { speculate_job(); });
+}
+
+/* Wait for the worker, and keep the results that the real reveal allows. */
+void speculate_commit() {
+    speculation_worker().wait();
+    auto &&__commit = [](const _Pos_List &__list) {
+        for(auto [x , y] : __list) {
+            if (pending_mark[x][y]) continue;
+            pending_mark[x][y] = true;
+            pending_safe.emplace_back(x,y);
+        }
+    };
+    __commit(speculated_safe);
+
+    auto [x , y] = speculated_move;
+    if (speculated_count != 0 && map[x][y].is_visited() && map[x][y].get_mine_count() == speculated_count)
+        __commit(conditional_safe);
+}
+
+/* Take a committed safe cell which is still unknown. */
+_Pos_Type take_pending() {
+    while (!pending_safe.empty()) {
+        auto [x , y] = pending_safe.back();
+        pending_safe.pop_back();
+        pending_mark[x][y] = false;
+        if (map[x][y].is_unknown()) return {x,y};
+    }
+    return kNOTFOUND;
+}
+
+/* Drop all speculation, e.g. when a new game starts. */
+void reset_speculation() {
+    if (kSPECULATE) speculation_worker().wait();
+    for(auto [x , y] : pending_safe) pending_mark[x][y] = false;
+    pending_safe.clear();
+}
+
+/* Send the move (x,y), solving in the background meanwhile in speculative mode. */
+void send_move(int x,int y) {
+    if (!kSPECULATE) {
+        Execute(x - 1,y - 1);
+        frontier_fresh = false;
+        return;
+    }
+    speculate_begin(x,y);
+    Execute(x - 1,y - 1);
+    frontier_fresh = false;
+    speculate_commit();
+}
+
+/**
+ * @brief Reset all the client state.
+ * Only needed when one process plays more than one game.
+ * Nothing carries over, so a game is played the same whatever came before,
+ * and storage kept in _Block_Pool goes back to it.
+ */
+void ResetClient() {
+    reset_speculation();
+    work_list.clear();
+    for(size_t __id = 1 ; __id <= components.size() ; ++__id) {
+        if (components[__id - 1].is_alive()) release_component(__id);
+    }
+    components.clear();
+    free_components.clear();
+    lookahead_round = 0;
+    frontier_fresh  = false;
+    for(size_t i = 0 ; i < kMAPSIZE ; ++i) {
+        for(size_t j = 0 ; j < kMAPSIZE ; ++j) {
+            map[i][j]        = state {};
+            snapshot[i][j]   = state {};
+            hypothesis[i][j] = hypothesis_entry {};
+            watchers[i][j].clear();
+            watchers[i][j].shrink_to_fit(); /* '= {}' would keep the storage. */
+        }
+    }
 }
 
 void Decide() {
+    _Arena_Guard __guard; /* Scratch data of this move dies here. */
     _Debug();
-    if (auto [x , y] = take_safe(); x != 0) return Execute(x - 1,y - 1);
-    // if (auto [x , y] = guessing() ; x != 0) return Execute(x - 1,y - 1);
+    if (auto [x , y] = take_pending(); x != 0) return send_move(x,y);
+    if (auto [x , y] = take_safe(); x != 0) return send_move(x,y);
+    if (auto [x , y] = guess_single(); x != 0) return send_move(x,y);
     auto [x , y] = take_random();
-    return Execute(x - 1,y - 1);
+    return send_move(x,y);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,107 @@
+#ifndef SELF_PLAY_H
+#define SELF_PLAY_H
+
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "client.h"
+#include "server.h"
+
+/*
+ * Self-play of the client against the server in one process, for the tools which play many games (generate and
+ * benchmark). Each tool defines its own Execute(), which calls VisitBlock() and then PassMap().
+ */
+
+struct GameOver {};
+
+/**
+ * @brief The definition of function InitSelfPlay()
+ *
+ * @details Silences the debug output of the client, and runs its lookahead on the calling thread only, so that every
+ * process keeps one core busy and all the pooled memory stays on one thread.
+ */
+void InitSelfPlay() {
+  std::cerr.setstate(std::ios::badbit);
+  lookahead_threads = 1;
+}
+
+/**
+ * @brief The definition of function NewBoard(std::mt19937_64 &, int)
+ *
+ * @details Resets the server, places the mines at random, and returns a block to start with (0 mines around if
+ * possible).
+ */
+std::pair<int, int> NewBoard(std::mt19937_64 &rng, int mines) {
+  game_state = total_safe_block = visit_count = step_count = 0;
+  state_hash = hash_chain = 0;
+  visited_blocks.clear();
+  std::vector<int> cells(rows * columns);
+  for (int i = 0; i < rows * columns; ++i) {
+    cells[i] = i;
+  }
+  for (int i = 0; i < mines; ++i) {
+    std::swap(cells[i], cells[i + rng() % (cells.size() - i)]);
+  }
+  for (int i = 0; i < rows; ++i) {
+    for (int j = 0; j < columns; ++j) {
+      mine_count[i][j] = 0;
+      visited[i][j] = false;
+    }
+  }
+  for (int i = 0; i < mines; ++i) {
+    mine_count[cells[i] / columns][cells[i] % columns] = -1;
+  }
+  total_safe_block = rows * columns - mines;
+  CountMines();
+
+  int start = cells[mines + rng() % (cells.size() - mines)];
+  for (size_t i = mines; i < cells.size(); ++i) {
+    if (mine_count[cells[i] / columns][cells[i] % columns] == 0) {
+      start = cells[i];
+      break;
+    }
+  }
+  return {start / columns, start % columns};
+}
+
+/**
+ * @brief The definition of function PassMap()
+ *
+ * @details The second half of Execute() in advanced.cpp: passes the map to the client directly, instead of printing it
+ * and reading it back. Throws GameOver instead of exiting when the game has ended.
+ */
+void PassMap() {
+  if (game_state != 0) {
+    throw GameOver{};
+  }
+  work_list.clear();
+  for (int i = 0; i < rows; ++i) {
+    for (int j = 0; j < columns; ++j) {
+      read_block(i + 1, j + 1, visited[i][j] ? '0' + mine_count[i][j] : '?');
+    }
+  }
+}
+
+/**
+ * @brief The definition of function PlayGame(std::mt19937_64 &, int, Decider &&)
+ *
+ * @details Plays one game on a new board, calling decide() for every move, which should call Decide().
+ * @return Whether the client has won.
+ */
+template <class Decider>
+bool PlayGame(std::mt19937_64 &rng, int mines, Decider &&decide) {
+  auto [first_row, first_column] = NewBoard(rng, mines);
+  ResetClient();
+  try {
+    Execute(first_row, first_column);
+    while (true) {
+      decide();
+    }
+  } catch (const GameOver &) {
+  }
+  return game_state == 1;
+}
+
+#endif
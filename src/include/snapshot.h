@@ -0,0 +1,243 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "server.h"
+
+/*
+ * Forkable copies of the game, for what-if search.
+ * A solver can take a snapshot, fork it many times, and play a different continuation on each fork. Forks share every
+ * tile they have not written, so a branch costs about as much as the blocks it changes, not the whole board.
+ */
+
+/**
+ * @brief Copy-on-write grid, split into kTile * kTile tiles
+ *
+ * @details Tiles are reached through a directory of tile rows. Copies of a grid share the directory, the tile rows and
+ * the tiles. Set() copies whichever of them are still shared, so copying a grid is O(1), and the first write to a tile
+ * after a copy costs one tile plus two rows of pointers.
+ *
+ * @note One grid object should be used by one thread at a time. Different copies may be used by different threads.
+ */
+template <class T, int kTile = 8>
+class CowGrid {
+ private:
+  using Tile = std::array<T, kTile * kTile>;
+  using TileRow = std::vector<std::shared_ptr<Tile>>;
+  using Directory = std::vector<std::shared_ptr<TileRow>>;
+
+  int rows_ = 0;
+  int columns_ = 0;
+  std::shared_ptr<Directory> directory_;
+
+  template <class Ptr>
+  static void Unshare(Ptr &ptr) {
+    if (ptr.use_count() > 1) {
+      ptr = std::make_shared<typename Ptr::element_type>(*ptr);
+    }
+  }
+
+ public:
+  CowGrid() = default;
+
+  /* All blocks start as value, sharing one tile. */
+  CowGrid(int rows, int columns, const T &value) : rows_(rows), columns_(columns) {
+    auto tile = std::make_shared<Tile>();
+    tile->fill(value);
+    auto tile_row = std::make_shared<TileRow>((columns + kTile - 1) / kTile, tile);
+    directory_ = std::make_shared<Directory>((rows + kTile - 1) / kTile, tile_row);
+  }
+
+  int Rows() const { return rows_; }
+  int Columns() const { return columns_; }
+
+  const T &Get(int row, int column) const {
+    return (*(*directory_)[row / kTile])[column / kTile]->at(row % kTile * kTile + column % kTile);
+  }
+
+  void Set(int row, int column, const T &value) {
+    if (Get(row, column) == value) {
+      return;
+    }
+    Unshare(directory_);
+    auto &tile_row = (*directory_)[row / kTile];
+    Unshare(tile_row);
+    auto &tile = (*tile_row)[column / kTile];
+    Unshare(tile);
+    tile->at(row % kTile * kTile + column % kTile) = value;
+  }
+};
+
+/**
+ * @brief A copy of the whole game state, which can be forked and played on its own
+ *
+ * @details Visit() follows the same rules as VisitBlock(), including step_count and state_hash, but never touches the
+ * global game. Capture() and Restore() copy the global game from and to a snapshot.
+ */
+class GameSnapshot {
+ private:
+  int rows_ = 0;
+  int columns_ = 0;
+  int game_state_ = 0;
+  int total_safe_block_ = 0;
+  int visit_count_ = 0;
+  int step_count_ = 0;
+  uint64_t state_hash_ = 0;
+  uint64_t hash_chain_ = 0;
+  CowGrid<int8_t> mine_count_;  // Never written after creation, so all forks share it
+  CowGrid<bool> visited_;
+
+ public:
+  GameSnapshot() = default;
+
+  /* A new game with no mines and no block visited. Add mines by SetMine() and then call CountMines(). */
+  GameSnapshot(int rows, int columns)
+      : rows_(rows),
+        columns_(columns),
+        total_safe_block_(rows * columns),
+        mine_count_(rows, columns, 0),
+        visited_(rows, columns, false) {}
+
+  /**
+   * @brief The definition of function Capture()
+   *
+   * @details Copies the global game into a snapshot. It costs O(rows * columns), so take one snapshot and fork it.
+   */
+  static GameSnapshot Capture() {
+    GameSnapshot snapshot(rows, columns);
+    snapshot.game_state_ = game_state;
+    snapshot.total_safe_block_ = total_safe_block;
+    snapshot.visit_count_ = visit_count;
+    snapshot.step_count_ = step_count;
+    snapshot.state_hash_ = state_hash;
+    snapshot.hash_chain_ = hash_chain;
+    for (int i = 0; i < rows; ++i) {
+      for (int j = 0; j < columns; ++j) {
+        snapshot.mine_count_.Set(i, j, mine_count[i][j]);
+        snapshot.visited_.Set(i, j, visited[i][j]);
+      }
+    }
+    return snapshot;
+  }
+
+  /**
+   * @brief The definition of function Restore()
+   *
+   * @details Copies the snapshot back into the global game, e.g. to undo the moves played since Capture().
+   */
+  void Restore() const {
+    rows = rows_;
+    columns = columns_;
+    game_state = game_state_;
+    total_safe_block = total_safe_block_;
+    visit_count = visit_count_;
+    step_count = step_count_;
+    state_hash = state_hash_;
+    hash_chain = hash_chain_;
+    visited_blocks.clear();
+    for (int i = 0; i < rows_; ++i) {
+      for (int j = 0; j < columns_; ++j) {
+        mine_count[i][j] = mine_count_.Get(i, j);
+        visited[i][j] = visited_.Get(i, j);
+        if (visited[i][j] && mine_count[i][j] != -1) {
+          visited_blocks.emplace(i, j);
+        }
+      }
+    }
+  }
+
+  /* A copy sharing all the blocks, which may then be played on its own. */
+  GameSnapshot Fork() const { return *this; }
+
+  /* Place a mine at (row, column). Only for a new game, before CountMines(). */
+  void SetMine(int row, int column) {
+    if (mine_count_.Get(row, column) != -1) {
+      mine_count_.Set(row, column, -1);
+      --total_safe_block_;
+    }
+  }
+
+  /* Same as the global CountMines(), for a snapshot built by SetMine(). */
+  void CountMines() {
+    for (int i = 0; i < rows_; ++i) {
+      for (int j = 0; j < columns_; ++j) {
+        if (mine_count_.Get(i, j) == -1) {
+          continue;
+        }
+        int8_t count = 0;
+        for (int dx = -1; dx <= 1; ++dx) {
+          for (int dy = -1; dy <= 1; ++dy) {
+            int nx = i + dx;
+            int ny = j + dy;
+            if (nx >= 0 && nx < rows_ && ny >= 0 && ny < columns_ && mine_count_.Get(nx, ny) == -1) {
+              ++count;
+            }
+          }
+        }
+        mine_count_.Set(i, j, count);
+      }
+    }
+  }
+
+  /**
+   * @brief The definition of function Visit(int, int)
+   *
+   * @details Same as VisitBlock(), on this snapshot only. The flood fill uses an explicit stack, so large empty areas
+   * cannot overflow the call stack.
+   */
+  void Visit(int row, int column) {
+    ++step_count_;
+    if (visited_.Get(row, column)) {
+      game_state_ = 0;
+    } else if (mine_count_.Get(row, column) == -1) {
+      visited_.Set(row, column, true);
+      state_hash_ ^= BlockHash(row, column, -1);
+      game_state_ = -1;
+    } else {
+      std::vector<std::pair<int, int>> stack = {{row, column}};
+      while (!stack.empty()) {
+        auto [x, y] = stack.back();
+        stack.pop_back();
+        if (visited_.Get(x, y) || mine_count_.Get(x, y) == -1) {
+          continue;
+        }
+        visited_.Set(x, y, true);
+        ++visit_count_;
+        state_hash_ ^= BlockHash(x, y, mine_count_.Get(x, y));
+        if (mine_count_.Get(x, y) != 0) {
+          continue;
+        }
+        for (int dx = -1; dx <= 1; ++dx) {
+          for (int dy = -1; dy <= 1; ++dy) {
+            int nx = x + dx;
+            int ny = y + dy;
+            if (nx >= 0 && nx < rows_ && ny >= 0 && ny < columns_) {
+              stack.emplace_back(nx, ny);
+            }
+          }
+        }
+      }
+      if (visit_count_ == total_safe_block_) {
+        game_state_ = 1;
+      }
+    }
+    hash_chain_ = MixHash(hash_chain_ ^ state_hash_);
+  }
+
+  int Rows() const { return rows_; }
+  int Columns() const { return columns_; }
+  int GameState() const { return game_state_; }
+  int VisitCount() const { return visit_count_; }
+  int StepCount() const { return step_count_; }
+  uint64_t StateHash() const { return state_hash_; }
+  uint64_t HashChain() const { return hash_chain_; }
+  bool IsVisited(int row, int column) const { return visited_.Get(row, column); }
+  int MineCount(int row, int column) const { return mine_count_.Get(row, column); }
+};
+
+#endif
@@ -1,9 +1,120 @@
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
 #include <iostream>
 
 #include "server.h"
 
-int main() {
+/**
+ * @brief Bulk reader of the move stream
+ * @details Reads stdin by large chunks with fread and parses the integers by hand, so that grading is not limited by
+ * iostreams. It is safe to use after std::cin, which reads through stdio while synced with it. Integers are separated by
+ * whitespace only, so anything like "-1" or "2x" is malformed rather than skipped.
+ */
+class MoveReader {
+ public:
+  enum Status { kMove, kEnd, kMalformed };
+
+ private:
+  static constexpr size_t kBufferSize = 1 << 16;
+  static constexpr int kMaxValue = 1 << 30;
+  char buffer_[kBufferSize];
+  size_t size_ = 0;
+  size_t pos_ = 0;
+
+  int Peek() {
+    if (pos_ == size_) {
+      size_ = std::fread(buffer_, 1, kBufferSize, stdin);
+      pos_ = 0;
+      if (size_ == 0) {
+        return EOF;
+      }
+    }
+    return buffer_[pos_];
+  }
+
+  static bool IsSpace(int ch) { return ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t'; }
+
+  Status ReadInt(int &value) {
+    int ch = Peek();
+    while (IsSpace(ch)) {
+      ++pos_;
+      ch = Peek();
+    }
+    if (ch == EOF) {
+      return kEnd;
+    }
+    if (ch < '0' || ch > '9') {
+      return kMalformed;
+    }
+    value = 0;
+    while (ch >= '0' && ch <= '9') {
+      if (value >= kMaxValue / 10) {
+        return kMalformed;
+      }
+      value = value * 10 + (ch - '0');
+      ++pos_;
+      ch = Peek();
+    }
+    return ch == EOF || IsSpace(ch) ? kMove : kMalformed;
+  }
+
+ public:
+  /* kEnd only if the input ends before the move. A move cut in half is malformed. */
+  Status ReadMove(int &pos_x, int &pos_y) {
+    Status status = ReadInt(pos_x);
+    if (status != kMove) {
+      return status;
+    }
+    status = ReadInt(pos_y);
+    return status == kEnd ? kMalformed : status;
+  }
+};
+
+/**
+ * @brief The definition of function RejectMove()
+ *
+ * @details Ends the game on a malformed or out-of-range move, before it is played. Prints "INVALID MOVE!", and then
+ * the same lines as ExitGame() for the moves played so far.
+ */
+void RejectMove() {
+  std::cout << "INVALID MOVE!" << std::endl;
+  std::cout << visit_count << " " << step_count << std::endl;
+  std::cout << std::hex << std::setw(16) << std::setfill('0') << hash_chain << std::endl;
+  exit(1);
+}
+
+/**
+ * @brief Headless mode, for checkers
+ * @details Prints no map at all. When the game ends, or the moves run out, ExitGame() prints the result and hash_chain.
+ * A malformed or out-of-range move is rejected by RejectMove().
+ */
+void RunHeadless() {
+  static MoveReader reader;
+  int pos_x;
+  int pos_y;
+  while (true) {
+    MoveReader::Status status = reader.ReadMove(pos_x, pos_y);
+    if (status == MoveReader::kEnd) {
+      break;
+    }
+    if (status == MoveReader::kMalformed || pos_x >= rows || pos_y >= columns) {
+      RejectMove();
+    }
+    VisitBlock(pos_x, pos_y);
+    if (game_state != 0) {
+      break;
+    }
+  }
+  ExitGame();
+}
+
+int main(int argc, char *argv[]) {
+  headless = argc > 1 && std::strcmp(argv[1], "--headless") == 0;
   InitMap();
+  if (headless) {
+    RunHeadless();
+  }
   PrintMap();
   while (true) {
     int pos_x;